@@ -129,6 +129,17 @@ namespace cairo {
             return *this;
         }
 
+        inline Context& clip(double x, double y, double width, double height) {
+            ::cairo_rectangle(pointer(), x, y, width, height);
+            ::cairo_clip(pointer());
+            return *this;
+        }
+
+        inline Context& operation(::cairo_operator_t op) {
+            ::cairo_set_operator(pointer(), op);
+            return *this;
+        }
+
         inline Context& paint() {
             ::cairo_paint(pointer());
             return *this;
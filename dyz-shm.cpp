@@ -1,5 +1,6 @@
 #include <glib.h>
 #include <wpe-fdo/view-backend-exportable.h>
+#include <wpe/view-backend.h>
 
 #include <WPE/WebKit.h>
 
@@ -13,6 +14,7 @@
 #include <cstdlib>
 #include <memory>
 #include <utility>
+#include <vector>
 #include <cstring>
 #include <cerrno>
 
@@ -32,14 +34,24 @@ namespace gfx = simplegfx;
 # error No graphics backend
 #endif
 
+#include "scroll.hh"
+#include "perf.hh"
+#include "overlay.hh"
+
 
 static struct {
     bool debug;
     bool suppressOutput;
+    bool disableScrollDetection;
+    bool profile;
     uint32_t fpsInterval;
+    uint32_t rotation;
+    bool hardwareRotation;
     const char* pngPath;
 } Options = { };
 
+static std::vector<overlay::Image> s_overlays;
+
 #define DEBUG(args) \
     do { \
         if (Options.debug) { g_printerr args ; } \
@@ -49,13 +61,8 @@ static struct {
 struct FrameBuffer {
 public:
     FrameBuffer(const char* devicePath = nullptr) : m_devicePath(devicePath) {
-        if (!m_devicePath) {
-            if (auto value = g_getenv("WPE_FBDEV")) {
-                m_devicePath = value;
-            } else {
-                m_devicePath = "/dev/fb0";
-            }
-        }
+        if (!m_devicePath)
+            m_devicePath = "/dev/fb0";
 
         do {
             m_fd = open(m_devicePath, O_RDWR);
@@ -68,6 +75,7 @@ public:
 
         if (!updateScreenInfo())
             return;
+        m_initialVarInfo = m_varInfo;
         DEBUG(("Framebuffer '%s' smem_len = %" PRIu32 "\n",
                m_devicePath, m_fixInfo.smem_len));
 
@@ -81,21 +89,7 @@ public:
         }
         DEBUG(("Framebuffer '%s' unblanked\n", m_devicePath));
 
-        if (size() > m_fixInfo.smem_len) {
-            markError("mmap", "size to mmap bigger than framebuffer size");
-            return;
-        }
-
-        m_buffer = mmap(nullptr, size(), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
-        if (m_buffer == MAP_FAILED || !m_buffer) {
-            markError("mmap", errno);
-            return;
-        }
-
-        if (!createSurface()) {
-            markError(gfx::name, "Cannot create device surface");
-            return;
-        }
+        map();
     }
 
     bool updateScreenInfo() {
@@ -119,9 +113,12 @@ public:
     }
 
     ~FrameBuffer() {
-        if (m_buffer) {
-            munmap(m_buffer, size());
-            m_buffer = nullptr;
+        unmap();
+
+        // Leave the device as it was found.
+        if (m_fd != -1 && m_varInfo.rotate != m_initialVarInfo.rotate) {
+            m_varInfo = m_initialVarInfo;
+            applyVarInfo();
         }
 
         if (m_fd != -1) {
@@ -139,11 +136,61 @@ public:
     inline uint32_t bpp() const { return m_varInfo.bits_per_pixel; }
     inline uint32_t rotation() const { return m_varInfo.rotate; }
 
+    void moveLines(uint32_t destination, uint32_t source, uint32_t count) {
+        uint8_t* base = reinterpret_cast<uint8_t*>(m_buffer);
+        memmove(base + destination * stride(), base + source * stride(), count * stride());
+    }
+
+    void moveColumns(uint32_t destination, uint32_t source, uint32_t count) {
+        const auto bytesPerPixel = bpp() / 8;
+        uint8_t* line = reinterpret_cast<uint8_t*>(m_buffer);
+        for (uint32_t y = 0; y < yres(); y++, line += stride()) {
+            memmove(line + destination * bytesPerPixel,
+                    line + source * bytesPerPixel,
+                    count * bytesPerPixel);
+        }
+    }
+
     bool setRotation(uint32_t rotation) {
         m_varInfo.rotate = rotation;
         return applyVarInfo();
     }
 
+    // Asks the driver to rotate the display, and checks whether it actually
+    // did. On success the framebuffer is mapped again using the geometry
+    // reported by the driver (check errored() afterwards); otherwise the
+    // previous settings are restored.
+    //
+    // Most drivers keep "rotate" without honouring it, so reading the value
+    // back proves nothing: quarter turns must also swap xres and yres. Half
+    // turns cannot be verified and are refused without touching the device,
+    // and so is a value which is already set (e.g. left over by a previous
+    // run). Going back to no rotation at all is always accepted.
+    bool probeRotation(uint32_t rotation) {
+        if (rotation == this->rotation())
+            return rotation == FB_ROTATE_UR;
+
+        const auto savedVarInfo = m_varInfo;
+        const bool swapsAxes = (rotation ^ savedVarInfo.rotate) & 1;
+        if (!swapsAxes && rotation != FB_ROTATE_UR)
+            return false;
+
+        if (setRotation(rotation) && updateScreenInfo() && this->rotation() == rotation
+            && (!swapsAxes || (xres() == savedVarInfo.yres && yres() == savedVarInfo.xres))) {
+            DEBUG(("Framebuffer '%s' rotation %" PRIu32 " set, %" PRIu32 "x%" PRIu32 "\n",
+                   m_devicePath, rotation, xres(), yres()));
+            unmap();
+            map();
+            return true;
+        }
+
+        m_varInfo = savedVarInfo;
+        applyVarInfo();
+        m_errorCause = m_errorMessage = nullptr;
+        updateScreenInfo();
+        return false;
+    }
+
     inline bool errored() const { return m_errorCause || m_errorMessage; }
     inline const char* errorMessage() const { return m_errorMessage; }
     inline const char* errorCause() const { return m_errorCause; }
@@ -162,6 +209,37 @@ protected:
         markError(cause, strerror(err));
     }
 
+    bool map() {
+        if (size() > m_fixInfo.smem_len) {
+            markError("mmap", "size to mmap bigger than framebuffer size");
+            return false;
+        }
+
+        m_buffer = mmap(nullptr, size(), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (m_buffer == MAP_FAILED || !m_buffer) {
+            m_buffer = nullptr;
+            markError("mmap", errno);
+            return false;
+        }
+        m_mappedSize = size();
+
+        if (!createSurface()) {
+            markError(gfx::name, "Cannot create device surface");
+            return false;
+        }
+        return true;
+    }
+
+    void unmap() {
+#if GRAPHICS_NEEDS_DEVICE_SURFACE
+        m_surface.reset();
+#endif
+        if (m_buffer) {
+            munmap(m_buffer, m_mappedSize);
+            m_buffer = nullptr;
+        }
+    }
+
     bool createSurface() {
 #if GRAPHICS_NEEDS_DEVICE_SURFACE
         // FIXME: Un-hardcode the framebuffer device surface format.
@@ -187,9 +265,11 @@ protected:
 private:
     int m_fd { -1 };
     void* m_buffer { nullptr };
+    uint64_t m_mappedSize { 0 };
     const char* m_errorMessage { nullptr };
     const char* m_errorCause { nullptr };
     struct fb_var_screeninfo m_varInfo { };
+    struct fb_var_screeninfo m_initialVarInfo { };
     struct fb_fix_screeninfo m_fixInfo { };
     const char* m_devicePath;
 
@@ -206,11 +286,546 @@ public:
 
 
 
-struct ViewData {
-    FrameBuffer& framebuffer;
-    struct wpe_view_backend_exportable_shm* exportable;
+enum ProfileStage {
+    ProfileStageHash = 0,
+    ProfileStageMove,
+    ProfileStageConvert,
+    ProfileStageCount,
+};
+
+static const char* const s_profileStageNames[ProfileStageCount] = {
+    "hash",
+    "move",
+    "convert",
 };
 
+using Profile = perf::Profile<ProfileStageCount>;
+
+
+struct View;
+
+// Pixels of a frame exported by WPE, or of a copy of it.
+struct Frame {
+    void* data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+};
+
+// Each head owns a framebuffer and a thread which blits into it the frames
+// exported by the view it displays, either its own or a mirrored one.
+struct Head {
+    explicit Head(const char* devicePath) : framebuffer(devicePath) {
+        g_mutex_init(&mutex);
+        g_cond_init(&cond);
+    }
+
+    ~Head() {
+        stop();
+        g_cond_clear(&cond);
+        g_mutex_clear(&mutex);
+    }
+
+    void start() {
+        thread = g_thread_new(framebuffer.devicePath(), [](gpointer data) -> gpointer {
+            reinterpret_cast<Head*>(data)->run();
+            return nullptr;
+        }, this);
+    }
+
+    void stop() {
+        if (!thread)
+            return;
+        g_mutex_lock(&mutex);
+        quit = true;
+        g_cond_signal(&cond);
+        g_mutex_unlock(&mutex);
+        g_thread_join(thread);
+        thread = nullptr;
+    }
+
+    inline bool isMirror() const;
+
+    // Hands a frame over to the blitting thread. Mirrors blit from their own
+    // copy of the frame, so the view does not need to wait for them; the
+    // copy is taken off the main loop, see takeCopy().
+    void post(const Frame& frame) {
+        g_mutex_lock(&mutex);
+        if (isMirror()) {
+            source = frame;
+            hasSource = true;
+        } else {
+            pending = frame;
+            hasPending = true;
+        }
+        g_cond_signal(&cond);
+        g_mutex_unlock(&mutex);
+    }
+
+    // Copies the frame posted to a mirror, by the mirror itself when idle or
+    // else by the view's own head once it is done blitting. Copies alternate
+    // between two buffers: while a mirror is busy blitting one, each new frame
+    // replaces the one waiting in the other, and the newest is blitted as
+    // soon as the mirror is done.
+    void takeCopy() {
+        g_mutex_lock(&mutex);
+        takeCopyLocked();
+        g_mutex_unlock(&mutex);
+    }
+
+    // Uses the rotation of the display driver when it honours the requested
+    // one (unless disabled), otherwise frames are rotated while blitting them. Frames
+    // are always rotated in software assuming the device is not rotated, so
+    // a rotation left over by a previous run is undone first.
+    void setupRotation(uint32_t requested) {
+        if (framebuffer.rotation() != FB_ROTATE_UR && (Options.hardwareRotation || requested == FB_ROTATE_UR)) {
+            if (!framebuffer.probeRotation(FB_ROTATE_UR))
+                DEBUG(("Framebuffer '%s' rotation %" PRIu32 " left as-is\n",
+                       framebuffer.devicePath(), framebuffer.rotation()));
+        }
+
+        if (Options.hardwareRotation && requested != FB_ROTATE_UR
+            && !framebuffer.errored() && framebuffer.probeRotation(requested)) {
+            g_debug("Framebuffer '%s' rotated by the driver", framebuffer.devicePath());
+            rotation = gfx::Rotation::None;
+        } else {
+            rotation = static_cast<gfx::Rotation>(requested);
+        }
+    }
+
+    inline bool swapsAxes() const {
+        return rotation == gfx::Rotation::ClockWise90 || rotation == gfx::Rotation::ClockWise270;
+    }
+    inline uint32_t viewWidth() const { return swapsAxes() ? framebuffer.yres() : framebuffer.xres(); }
+    inline uint32_t viewHeight() const { return swapsAxes() ? framebuffer.xres() : framebuffer.yres(); }
+
+    void setupOverlays() {
+        for (auto& overlay : s_overlays) {
+#if GRAPHICS_NEEDS_DEVICE_SURFACE
+            overlaySurfaces.emplace_back(new gfx::Surface(gfx::format::ARGB32,
+                                                          const_cast<uint32_t*>(overlay.data()),
+                                                          overlay.width(),
+                                                          overlay.height(),
+                                                          overlay.stride()));
+#else
+            overlays.push_back({
+                overlay.data(),
+                overlay.stride(),
+                overlay.x,
+                overlay.y,
+                overlay.width(),
+                overlay.height(),
+            });
+#endif
+        }
+    }
+
+    void run();
+    void blit(const Frame&);
+    void reportStats();
+
+    FrameBuffer framebuffer;
+    gfx::Rotation rotation { gfx::Rotation::None };
+    View* view { nullptr };
+    scroll::Detector scrollDetector;
+    std::unique_ptr<Profile> profile;
+#if GRAPHICS_NEEDS_DEVICE_SURFACE
+    std::vector<std::unique_ptr<gfx::Surface>> overlaySurfaces;
+    std::vector<uint32_t> overlayScratch;
+#else
+    std::vector<simplegfx::Overlay> overlays;
+#endif
+
+    struct {
+        uint32_t frames;
+        uint32_t scrollEvents;
+        uint64_t bytesSaved;
+        gint64 lastTime;
+    } stats { };
+
+    GThread* thread { nullptr };
+    GMutex mutex;
+    GCond cond;
+    Frame pending { };
+    bool hasPending { false };
+    bool quit { false };
+    Frame source { };
+    bool hasSource { false };
+    std::vector<uint8_t> copies[2];
+    unsigned nextCopy { 0 };
+
+private:
+    Head(const Head&) = delete;
+    void operator=(const Head&) = delete;
+
+    void takeCopyLocked();
+};
+
+
+// A WPE view. The first head is the one which loads the view; the rest are
+// mirrors. Frames are released back to WebKit as soon as the first head is
+// done blitting and every mirror has taken its copy.
+struct View {
+    struct wpe_view_backend_exportable_shm* exportable { nullptr };
+    WKViewRef view { nullptr };
+    std::vector<Head*> heads;
+    struct wpe_view_backend_exportable_shm_buffer* buffer { nullptr };
+    gint users { 0 };
+
+    // Called by each head once done with the buffer.
+    void frameDone() {
+        if (!g_atomic_int_dec_and_test(&users))
+            return;
+        // WPE is not thread-safe, notify it from the main loop.
+        g_idle_add([](gpointer data) -> gboolean {
+            reinterpret_cast<View*>(data)->release();
+            return G_SOURCE_REMOVE;
+        }, this);
+    }
+
+    void release() {
+        auto* released = buffer;
+        buffer = nullptr;
+        wpe_view_backend_exportable_shm_dispatch_frame_complete(exportable);
+        wpe_view_backend_exportable_shm_dispatch_release_buffer(exportable, released);
+    }
+};
+
+
+inline bool Head::isMirror() const {
+    return view->heads.front() != this;
+}
+
+
+void Head::takeCopyLocked() {
+    if (!hasSource)
+        return;
+
+    auto& buffer = copies[nextCopy];
+    buffer.resize(static_cast<size_t>(source.stride) * source.height);
+    memcpy(buffer.data(), source.data, buffer.size());
+    pending = source;
+    pending.data = buffer.data();
+    hasPending = true;
+    hasSource = false;
+    view->frameDone();
+}
+
+
+void Head::run() {
+    if (Options.profile) {
+        profile.reset(new Profile(s_profileStageNames));
+        if (!profile->open()) {
+            g_printerr("Cannot open performance counters for '%s': %s\n",
+                       framebuffer.devicePath(),
+                       profile->counters().errorMessage());
+            profile.reset();
+        }
+    }
+    setupOverlays();
+    stats.lastTime = g_get_monotonic_time();
+
+    g_mutex_lock(&mutex);
+    while (true) {
+        while (!hasPending && !hasSource && !quit)
+            g_cond_wait(&cond, &mutex);
+        if (quit)
+            break;
+
+        takeCopyLocked();
+
+        // Further copies go to the buffer which is not being blitted.
+        auto frame = pending;
+        hasPending = false;
+        nextCopy ^= 1;
+        g_mutex_unlock(&mutex);
+
+        blit(frame);
+        if (!isMirror()) {
+            for (size_t i = 1; i < view->heads.size(); i++)
+                view->heads[i]->takeCopy();
+            view->frameDone();
+        }
+
+        reportStats();
+        g_mutex_lock(&mutex);
+    }
+    g_mutex_unlock(&mutex);
+}
+
+
+void Head::blit(const Frame& frame)
+{
+#if GRAPHICS_NEEDS_DEVICE_SURFACE
+    gfx::Surface image {
+        gfx::format::ARGB32,
+            frame.data,
+            frame.width,
+            frame.height,
+            frame.stride
+    };
+#endif
+
+#if GRAPHICS_CAIRO
+    if (!image) {
+        g_printerr("Could not create cairo surface for SHM buffer: %s\n", image.statusString());
+        return;
+    }
+
+    if (Options.pngPath) {
+        char filename[PATH_MAX];
+        static gint files = 0;
+        snprintf(filename, PATH_MAX, "%s/dump_%d.png", Options.pngPath, g_atomic_int_add(&files, 1));
+        cairo_surface_write_to_png(image.pointer(), filename);
+        g_printerr("dump image data to %s\n", filename);
+    }
+#endif
+
+    const uint32_t width = frame.width;
+    const uint32_t height = frame.height;
+
+    // Maps an area of the SHM buffer to the framebuffer.
+    struct Rect { uint32_t x, y, width, height; };
+    auto rotateRect = [&](const Rect& r) -> Rect {
+        switch (rotation) {
+            case gfx::Rotation::ClockWise90:
+                return { height - r.y - r.height, r.x, r.height, r.width };
+            case gfx::Rotation::ClockWise180:
+                return { width - r.x - r.width, height - r.y - r.height, r.width, r.height };
+            case gfx::Rotation::ClockWise270:
+                return { r.y, width - r.x - r.width, r.height, r.width };
+            default:  // No rotation.
+                return r;
+        }
+    };
+    // Framebuffer area covered by rows [firstRow, endRow) of the SHM buffer.
+    auto framebufferRect = [&](uint32_t firstRow, uint32_t endRow) {
+        return rotateRect({ 0, firstRow, width, endRow - firstRow });
+    };
+
+#if GRAPHICS_NEEDS_DEVICE_SURFACE
+    // Part of an overlay within rows [firstRow, endRow), clipped to the buffer.
+    auto overlayRect = [&](const overlay::Image& image, uint32_t firstRow, uint32_t endRow) -> Rect {
+        const int64_t left = std::max<int64_t>(image.x, 0);
+        const int64_t right = std::min<int64_t>(static_cast<int64_t>(image.x) + image.width(), width);
+        const int64_t top = std::max<int64_t>(image.y, firstRow);
+        const int64_t bottom = std::min<int64_t>(static_cast<int64_t>(image.y) + image.height(), endRow);
+        if (left >= right || top >= bottom)
+            return { 0, 0, 0, 0 };
+        return {
+            static_cast<uint32_t>(left),
+            static_cast<uint32_t>(top),
+            static_cast<uint32_t>(right - left),
+            static_cast<uint32_t>(bottom - top),
+        };
+    };
+#endif
+
+#if GRAPHICS_SIMPLE
+    if (viewWidth() < width || viewHeight() < height) {
+        DEBUG(("Framebuffer '%s' too small for %" PRIu32 "x%" PRIu32 " frame, skipped\n",
+               framebuffer.devicePath(), width, height));
+        return;
+    }
+#endif
+
+#if GRAPHICS_NEEDS_DEVICE_SURFACE
+    // Writes rows [firstRow, endRow) of the SHM buffer into the framebuffer,
+    // taking them from "source", which holds the buffer rows from "sourceTop"
+    // onwards. Each framebuffer pixel is written once, without reading it.
+    auto paintRows = [&](gfx::Surface& source, uint32_t sourceTop, uint32_t firstRow, uint32_t endRow) {
+#if GRAPHICS_CAIRO
+        gfx::Context context { framebuffer.surface() };
+        context.rotate(image, rotation)
+            .clip(0, firstRow, width, endRow - firstRow)
+            .source(source, 0, sourceTop)
+            .operation(CAIRO_OPERATOR_SOURCE)
+            .paint();
+#elif GRAPHICS_PIXMAN
+        source.setTransform(pixman::Transform::rotate(rotation, width, height).translate(0, -1.0 * sourceTop));
+        const auto rect = framebufferRect(firstRow, endRow);
+        ::pixman_image_composite32(PIXMAN_OP_SRC,
+                                   source.pointer(),
+                                   nullptr,
+                                   framebuffer.surface().pointer(),
+                                   rect.x, rect.y,
+                                   0, 0,
+                                   rect.x, rect.y,
+                                   rect.width,
+                                   rect.height);
+#endif
+    };
+
+    // Rows covered by overlays are assembled in a scratch buffer (frame rows,
+    // then the overlays blended over them) which is converted in one go, so
+    // that blending does not read back from the framebuffer.
+    auto paintOverlayRows = [&](uint32_t firstRow, uint32_t endRow) {
+        const uint32_t rows = endRow - firstRow;
+        overlayScratch.resize(static_cast<size_t>(width) * rows);
+        for (uint32_t y = 0; y < rows; y++) {
+            memcpy(&overlayScratch[static_cast<size_t>(width) * y],
+                   static_cast<const uint8_t*>(frame.data) + static_cast<size_t>(frame.stride) * (firstRow + y),
+                   width * sizeof(uint32_t));
+        }
+
+        gfx::Surface scratch {
+            gfx::format::ARGB32,
+                overlayScratch.data(),
+                width,
+                rows,
+                width * static_cast<uint32_t>(sizeof(uint32_t))
+        };
+        for (size_t i = 0; i < s_overlays.size(); i++) {
+            const auto& overlay = s_overlays[i];
+            const auto area = overlayRect(overlay, firstRow, endRow);
+            if (!area.width)
+                continue;
+#if GRAPHICS_CAIRO
+            gfx::Context context { scratch };
+            context.source(*overlaySurfaces[i], overlay.x, overlay.y - static_cast<int64_t>(firstRow))
+                .clip(area.x, area.y - firstRow, area.width, area.height)
+                .paint();
+#elif GRAPHICS_PIXMAN
+            ::pixman_image_composite32(PIXMAN_OP_OVER,
+                                       overlaySurfaces[i]->pointer(),
+                                       nullptr,
+                                       scratch.pointer(),
+                                       area.x - overlay.x, area.y - overlay.y,
+                                       0, 0,
+                                       area.x, area.y - firstRow,
+                                       area.width,
+                                       area.height);
+#endif
+        }
+        paintRows(scratch, firstRow, firstRow, endRow);
+    };
+#endif
+
+    // Converts rows [firstRow, endRow) of the SHM buffer into the framebuffer.
+    uint64_t convertedPixels = 0;
+    auto convertRows = [&](uint32_t firstRow, uint32_t endRow) {
+        if (firstRow >= endRow)
+            return;
+        convertedPixels += static_cast<uint64_t>(width) * (endRow - firstRow);
+#if GRAPHICS_NEEDS_DEVICE_SURFACE
+        while (firstRow < endRow) {
+            // Next run of rows covered by overlays, merging those which overlap.
+            uint32_t top = endRow, bottom = endRow;
+            for (const auto& overlay : s_overlays) {
+                const auto area = overlayRect(overlay, firstRow, endRow);
+                if (area.width && area.y < top) {
+                    top = area.y;
+                    bottom = area.y + area.height;
+                }
+            }
+            for (bool grown = true; grown;) {
+                grown = false;
+                for (const auto& overlay : s_overlays) {
+                    const auto area = overlayRect(overlay, top, endRow);
+                    if (area.width && area.y <= bottom && area.y + area.height > bottom) {
+                        bottom = area.y + area.height;
+                        grown = true;
+                    }
+                }
+            }
+
+            if (firstRow < top)
+                paintRows(image, 0, firstRow, top);
+            if (top < bottom)
+                paintOverlayRows(top, bottom);
+            firstRow = bottom;
+        }
+#elif GRAPHICS_SIMPLE
+        simplegfx::convertRows(frame.data,
+                               frame.stride,
+                               width,
+                               height,
+                               framebuffer.data(),
+                               framebuffer.stride(),
+                               rotation,
+                               firstRow,
+                               endRow,
+                               overlays.data(),
+                               overlays.size());
+#endif
+    };
+
+    if (profile)
+        profile->begin();
+
+    scroll::Result band { 0, 0, 0 };
+    if (!Options.disableScrollDetection) {
+        band = scrollDetector.update(frame.data,
+                                     frame.width,
+                                     frame.height,
+                                     frame.stride);
+    }
+    // Overlays are always redrawn: neither their rows nor the rows which
+    // would bring overlay pixels along from the previous frame are moved.
+    for (const auto& overlay : s_overlays) {
+        band.exclude(overlay.y, static_cast<int64_t>(overlay.y) + overlay.height());
+        band.exclude(static_cast<int64_t>(overlay.y) - band.delta,
+                     static_cast<int64_t>(overlay.y) + overlay.height() - band.delta);
+    }
+    if (profile)
+        profile->end(ProfileStageHash, static_cast<uint64_t>(width) * height);
+
+    uint64_t movedPixels = 0;
+    if (band.delta != 0) {
+        DEBUG(("Framebuffer '%s' scroll %+" PRIi32 " rows, reusing [%" PRIu32 ", %" PRIu32 ")\n",
+               framebuffer.devicePath(), band.delta, band.top, band.bottom));
+        // The framebuffer area for the band, taken from where it was in the previous frame.
+        const auto rect = framebufferRect(band.top, band.bottom);
+        const auto previous = framebufferRect(band.top + band.delta, band.bottom + band.delta);
+        if (swapsAxes())
+            framebuffer.moveColumns(rect.x, previous.x, rect.width);
+        else
+            framebuffer.moveLines(rect.y, previous.y, rect.height);
+        stats.scrollEvents++;
+        movedPixels = static_cast<uint64_t>(width) * band.rows();
+    }
+    if (profile)
+        profile->end(ProfileStageMove, movedPixels);
+
+    if (band.empty()) {
+        convertRows(0, height);
+    } else {
+        convertRows(0, band.top);
+        convertRows(band.bottom, height);
+        stats.bytesSaved += static_cast<uint64_t>(band.rows()) * width * framebuffer.bpp() / 8;
+    }
+    if (profile) {
+        profile->end(ProfileStageConvert, convertedPixels);
+        profile->frame();
+    }
+}
+
+
+void Head::reportStats()
+{
+    if (Options.fpsInterval == 0)
+        return;
+
+    ++stats.frames;
+    gint64 time = g_get_monotonic_time();
+    if (time - stats.lastTime >= Options.fpsInterval * G_USEC_PER_SEC) {
+        double elapsedSeconds = static_cast<double>(time - stats.lastTime) / G_USEC_PER_SEC;
+        g_printerr("[fps] %s: %4.2f (%" PRIu32 " frames in %.2fs)\n",
+                   framebuffer.devicePath(),
+                   stats.frames / elapsedSeconds, stats.frames, elapsedSeconds);
+        if (!Options.disableScrollDetection) {
+            g_printerr("[scroll] %s: %" PRIu32 " events, %" PRIu64 " bytes saved\n",
+                       framebuffer.devicePath(), stats.scrollEvents, stats.bytesSaved);
+        }
+        if (profile)
+            profile->report(gfx::name);
+        stats.frames = 0;
+        stats.scrollEvents = 0;
+        stats.bytesSaved = 0;
+        stats.lastTime = time;
+    }
+}
+
 
 static struct wpe_view_backend_exportable_shm_client s_exportableSHMClient = {
     // export_buffer
@@ -226,78 +841,27 @@ static struct wpe_view_backend_exportable_shm_client s_exportableSHMClient = {
                buffer->height,
                buffer->stride));
 
-        auto* viewData = reinterpret_cast<ViewData*>(data);
-
-        if (!Options.suppressOutput) {
-            gfx::Surface image {
-                gfx::format::ARGB32,
-                    buffer->data,
-                    static_cast<uint32_t>(buffer->width),
-                    static_cast<uint32_t>(buffer->height),
-                    static_cast<uint32_t>(buffer->stride)
-            };
+        auto* view = reinterpret_cast<View*>(data);
+        g_assert(view->buffer == nullptr);
+        view->buffer = buffer;
 
-#if GRAPHICS_CAIRO
-            if (!image) {
-                g_printerr("Could not create cairo surface for SHM buffer: %s\n", image.statusString());
-                return;
-            }
-
-            if (Options.pngPath) {
-                char filename[PATH_MAX];
-                static int files = 0;
-                snprintf(filename, PATH_MAX, "%s/dump_%d.png", Options.pngPath, files++);
-                cairo_surface_write_to_png(image.pointer(), filename);
-                g_printerr("dump image data to %s\n", filename);
-            }
-
-            gfx::Context context { viewData->framebuffer.surface() };
-            context.rotate(image, gfx::Rotation::CounterClockWise90).source(image).paint();
-
-#elif GRAPHICS_PIXMAN
-            image->setTransform(pixman::Transform::rotate(90));
-            ::pixman_image_composite(PIXMAN_OP_SRC,
-                                     image.pointer(),
-                                     nullptr,
-                                     viewData->framebuffer.surface().pointer(),
-                                     0, 0,
-                                     0, 0,
-                                     0, 0,
-                                     image.width(),
-                                     image.height());
-#elif GRAPHICS_SIMPLE
-            auto fbLines = viewData->framebuffer.yres();
-            auto fbColumns = viewData->framebuffer.xres();
-            auto fbStride = viewData->framebuffer.stride();
-            uint8_t* fbData = reinterpret_cast<uint8_t*>(viewData->framebuffer.data());
-            uint8_t* bufData = reinterpret_cast<uint8_t*>(buffer->data);
-
-            for (auto fbY = 0; fbY < fbLines; fbY++) {
-                uint16_t *fbLineData = reinterpret_cast<uint16_t*>(fbData + fbStride * fbY);
-                for (auto fbX = 0; fbX < fbColumns; fbX++) {
-                    fbLineData[fbX] = simplegfx::Argb32toRgb565_v0(
-                                                                   reinterpret_cast<uint16_t*>(reinterpret_cast<uint8_t*>(buffer->data) + buffer->stride * fbX)[fbLines - fbY]);
-                }
-            }
-#endif
+        if (Options.suppressOutput) {
+            view->release();
+            return;
         }
 
-        wpe_view_backend_exportable_shm_dispatch_frame_complete(viewData->exportable);
-        wpe_view_backend_exportable_shm_dispatch_release_buffer(viewData->exportable, buffer);
-
-        if (Options.fpsInterval > 0) {
-            static uint32_t sFrameCount = 0;
-            static gint64 sLastTime = g_get_monotonic_time();
-            ++sFrameCount;
-            gint64 time = g_get_monotonic_time();
-            if (time - sLastTime >= Options.fpsInterval * G_USEC_PER_SEC) {
-                double elapsedSeconds = static_cast<double>(time - sLastTime) / G_USEC_PER_SEC;
-                g_printerr("[fps] %4.2f (%" PRIu32 " frames in %.2fs)\n",
-                           sFrameCount / elapsedSeconds, sFrameCount, elapsedSeconds);
-                sFrameCount = 0;
-                sLastTime = time;
-            }
-        }
+        const Frame frame {
+            buffer->data,
+            static_cast<uint32_t>(buffer->width),
+            static_cast<uint32_t>(buffer->height),
+            static_cast<uint32_t>(buffer->stride),
+        };
+
+        // WPE does not export a new frame before the previous one is released,
+        // which happens once every head is done with it.
+        g_atomic_int_set(&view->users, view->heads.size());
+        for (auto* head : view->heads)
+            head->post(frame);
     },
 };
 
@@ -373,6 +937,12 @@ int main(int argc, char *argv[])
     if (auto value = g_getenv("WPE_DYZSHM_NO_OUTPUT")) {
         Options.suppressOutput = strcmp(value, "0") != 0;
     }
+    if (auto value = g_getenv("WPE_DYZSHM_NO_SCROLL_DETECT")) {
+        Options.disableScrollDetection = strcmp(value, "0") != 0;
+    }
+    if (auto value = g_getenv("WPE_DYZSHM_PROFILE")) {
+        Options.profile = strcmp(value, "0") != 0;
+    }
     if (auto value = g_getenv("WPE_DUMP_PNG_PATH")) {
         Options.pngPath = value;
     }
@@ -389,27 +959,142 @@ int main(int argc, char *argv[])
         Options.fpsInterval = valueAsUlong;
     }
 
+    // Rotation in degrees, clockwise. Defaults to a counter-clockwise quarter turn.
+    Options.rotation = FB_ROTATE_CCW;
+    if (auto value = g_getenv("WPE_DYZSHM_ROTATION")) {
+        if (strcmp(value, "0") == 0) {
+            Options.rotation = FB_ROTATE_UR;
+        } else if (strcmp(value, "90") == 0) {
+            Options.rotation = FB_ROTATE_CW;
+        } else if (strcmp(value, "180") == 0) {
+            Options.rotation = FB_ROTATE_UD;
+        } else if (strcmp(value, "270") == 0) {
+            Options.rotation = FB_ROTATE_CCW;
+        } else {
+            g_printerr("Invalid rotation '%s', must be one of 0, 90, 180, 270\n", value);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Overlays are given as "PATH[@X,Y]" entries separated by colons. Paths
+    // may contain '@' themselves: only a trailing "@X,Y" is a position.
+    if (auto value = g_getenv("WPE_DYZSHM_OVERLAY")) {
+        char** entries = g_strsplit(value, ":", -1);
+        for (char** entry = entries; *entry; entry++) {
+            if (!**entry)
+                continue;
+
+            overlay::Image image;
+            if (char* position = strrchr(*entry, '@')) {
+                int32_t x, y;
+                int consumed = 0;
+                if (sscanf(position + 1, "%" SCNd32 ",%" SCNd32 "%n", &x, &y, &consumed) == 2
+                    && position[1 + consumed] == '\0') {
+                    *position = '\0';
+                    image.x = x;
+                    image.y = y;
+                }
+            }
+            if (!image.load(*entry)) {
+                g_printerr("Cannot load overlay '%s': %s\n", *entry, image.errorMessage());
+                return EXIT_FAILURE;
+            }
+            g_debug("Overlay '%s' %" PRIu32 "x%" PRIu32 " @ %" PRIi32 ",%" PRIi32,
+                    *entry, image.width(), image.height(), image.x, image.y);
+            s_overlays.push_back(std::move(image));
+        }
+        g_strfreev(entries);
+    }
+
+    // The display driver is asked to rotate unless WPE_DYZSHM_HW_ROTATION=0.
+    Options.hardwareRotation = true;
+    if (auto value = g_getenv("WPE_DYZSHM_HW_ROTATION")) {
+        Options.hardwareRotation = strcmp(value, "0") != 0;
+    }
+
     g_debug("Dyz-SHM with %s graphics (built %s)", gfx::name, __DATE__);
     g_debug("FPS reporting interval: %lu", Options.fpsInterval);
 
-    FrameBuffer framebuffer;
-    if (framebuffer.errored()) {
-        g_printerr("Cannot initialize framebuffer: %s (%s)\n",
-                   framebuffer.errorMessage(),
-                   framebuffer.errorCause());
+    // WPE_FBDEV may list several devices separated by commas, one per head.
+    const char* deviceList = g_getenv("WPE_FBDEV");
+    char** devicePaths = g_strsplit(deviceList ? deviceList : "/dev/fb0", ",", -1);
+    const guint headCount = g_strv_length(devicePaths);
+    if (headCount == 0) {
+        g_printerr("No framebuffer devices given in WPE_FBDEV\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::unique_ptr<Head>> heads;
+    for (guint i = 0; i < headCount; i++) {
+        heads.emplace_back(new Head(devicePaths[i]));
+        auto& framebuffer = heads.back()->framebuffer;
+        if (!framebuffer.errored())
+            heads.back()->setupRotation(Options.rotation);
+        if (framebuffer.errored()) {
+            g_printerr("Cannot initialize framebuffer '%s': %s (%s)\n",
+                       framebuffer.devicePath(),
+                       framebuffer.errorMessage(),
+                       framebuffer.errorCause());
+            return EXIT_FAILURE;
+        }
+
+        g_debug("Framebuffer '%s' @ %" PRIu32 "x%" PRIu32 " %" PRIu32 "bpp"
+                " (%" PRIu32 ", stride %" PRIu32 ", size %" PRIu64 ", %p)\n",
+                framebuffer.devicePath(),
+                framebuffer.xres(),
+                framebuffer.yres(),
+                framebuffer.bpp(),
+                framebuffer.rotation(),
+                framebuffer.stride(),
+                framebuffer.size(),
+                framebuffer.constData());
+    }
+
+    // Command line arguments give the URL for each head, in the same order
+    // as WPE_FBDEV; "@N" mirrors head N instead. Heads without an argument
+    // mirror the first head which loads an URL.
+    if (argc - 1 > static_cast<int>(headCount)) {
+        g_printerr("More URLs (%d) than framebuffer devices (%u)\n", argc - 1, headCount);
+        return EXIT_FAILURE;
+    }
+    std::vector<const char*> urls(headCount, nullptr);
+    for (int i = 1; i < argc; i++)
+        urls[i - 1] = argv[i];
+    if (argc == 1)
+        urls[0] = "http://igalia.com";
+
+    auto loadsURL = [&](guint i) { return urls[i] && urls[i][0] != '@'; };
+
+    std::vector<int> mirrorOf(headCount, -1);
+    int firstView = -1;
+    for (guint i = 0; i < headCount && firstView == -1; i++)
+        if (loadsURL(i))
+            firstView = i;
+    if (firstView == -1) {
+        g_printerr("At least one framebuffer device must be given an URL\n");
         return EXIT_FAILURE;
     }
+    for (guint i = 0; i < headCount; i++) {
+        if (loadsURL(i))
+            continue;
+        if (!urls[i]) {
+            mirrorOf[i] = firstView;
+            continue;
+        }
+        char *end = nullptr;
+        auto index = std::strtoul(urls[i] + 1, &end, 10);
+        if (*end != '\0' || end == urls[i] + 1 || index >= headCount || !loadsURL(index)) {
+            g_printerr("Invalid mirror '%s' for '%s': must name a device which loads an URL\n",
+                       urls[i], devicePaths[i]);
+            return EXIT_FAILURE;
+        }
+        mirrorOf[i] = index;
+    }
 
-    g_debug("Framebuffer '%s' @ %" PRIu32 "x%" PRIu32 " %" PRIu32 "bpp"
-            " (%" PRIu32 ", stride %" PRIu32 ", size %" PRIu64 ", %p)\n",
-            framebuffer.devicePath(),
-            framebuffer.xres(),
-            framebuffer.yres(),
-            framebuffer.bpp(),
-            framebuffer.rotation(),
-            framebuffer.stride(),
-            framebuffer.size(),
-            framebuffer.constData());
+    if (Options.profile && !Options.fpsInterval) {
+        g_printerr("Performance counters are reported every WPE_DYZSHM_SHOW_FPS seconds,"
+                   " which is unset\n");
+    }
 
     GMainLoop* loop = g_main_loop_new(g_main_context_default(), FALSE);
 
@@ -442,18 +1127,41 @@ int main(int argc, char *argv[])
         WKRelease(preferences);
     }
 
-    ViewData viewData { framebuffer, nullptr };
-    auto* backendExportable = wpe_view_backend_exportable_shm_create(&s_exportableSHMClient, &viewData);
-    viewData.exportable = backendExportable;
+    // All the views share the same WKContext, and therefore the same
+    // network and web processes.
+    std::vector<std::unique_ptr<View>> views;
+    for (guint i = 0; i < headCount; i++) {
+        if (mirrorOf[i] != -1)
+            continue;
+
+        views.emplace_back(new View);
+        auto* view = views.back().get();
+        heads[i]->view = view;
+        view->heads.push_back(heads[i].get());
+        for (guint j = 0; j < headCount; j++) {
+            if (mirrorOf[j] == static_cast<int>(i)) {
+                heads[j]->view = view;
+                view->heads.push_back(heads[j].get());
+            }
+        }
 
-    auto* backend = wpe_view_backend_exportable_shm_get_view_backend(backendExportable);
-    auto view = WKViewCreateWithViewBackend(backend, pageConfiguration);
-    auto page = WKViewGetPage(view);
+        view->exportable = wpe_view_backend_exportable_shm_create(&s_exportableSHMClient, view);
+        auto* backend = wpe_view_backend_exportable_shm_get_view_backend(view->exportable);
+        for (auto* head : view->heads) {
+            if (head->viewWidth() != heads[i]->viewWidth() || head->viewHeight() != heads[i]->viewHeight()) {
+                g_warning("Framebuffer '%s' mirrors '%s' with a different geometry.",
+                          head->framebuffer.devicePath(), heads[i]->framebuffer.devicePath());
+            }
+        }
+        view->view = WKViewCreateWithViewBackend(backend, pageConfiguration);
+        // Only forwarded once WebKit has registered its backend client,
+        // which happens while creating the view.
+        wpe_view_backend_dispatch_set_size(backend, heads[i]->viewWidth(), heads[i]->viewHeight());
+        auto page = WKViewGetPage(view->view);
 
-    WKPageSetPageNavigationClient(page, &NavigationClient.base);
+        WKPageSetPageNavigationClient(page, &NavigationClient.base);
 
-    {
-        const auto url = (argc > 1) ? argv[1] : "http://igalia.com";
+        const auto url = urls[i];
         auto isFileURL = strncmp(url, "file://", 7) == 0;
         auto shellURL = WKURLCreateWithUTF8CString(url);
         if (isFileURL) {
@@ -468,15 +1176,25 @@ int main(int argc, char *argv[])
         WKRelease(shellURL);
     }
 
+    for (auto& head : heads)
+        head->start();
+
     g_main_loop_run(loop);
 
-    WKRelease(view);
+    for (auto& head : heads)
+        head->stop();
 
-    wpe_view_backend_exportable_shm_destroy(backendExportable);
+    for (auto& view : views) {
+        WKRelease(view->view);
+        wpe_view_backend_exportable_shm_destroy(view->exportable);
+    }
 
     WKRelease(pageConfiguration);
     WKRelease(context);
 
+    heads.clear();
+    g_strfreev(devicePaths);
+
     g_main_loop_unref(loop);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,144 @@
+/*
+ * overlay.hh
+ * Copyright (C) 2017 Adrian Perez <aperez@igalia.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef OVERLAY_HH
+#define OVERLAY_HH
+
+#include <glib.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace overlay {
+
+    /*
+     * Static image composited over the frames, at a fixed position in view
+     * coordinates. Images are read from PAM files (RGB or RGB_ALPHA tuples,
+     * 8 bits per sample), and kept as premultiplied ARGB32.
+     */
+    class Image {
+    public:
+        // Largest width or height accepted, which keeps sizes and strides
+        // well within 32 bits.
+        constexpr static uint32_t maximumSize = 16384;
+
+        Image() = default;
+        Image(Image&&) = default;
+
+        bool load(const char* path) {
+            gchar* contents = nullptr;
+            gsize length = 0;
+            if (!g_file_get_contents(path, &contents, &length, nullptr)) {
+                m_errorMessage = "Cannot read file";
+                return false;
+            }
+            bool ok = parse(reinterpret_cast<const uint8_t*>(contents), length);
+            g_free(contents);
+            return ok;
+        }
+
+        inline const uint32_t* data() const { return m_pixels.data(); }
+        inline uint32_t width() const { return m_width; }
+        inline uint32_t height() const { return m_height; }
+        inline uint32_t stride() const { return m_width * sizeof(uint32_t); }
+        inline const char* errorMessage() const { return m_errorMessage; }
+
+        int32_t x { 0 };
+        int32_t y { 0 };
+
+    private:
+        Image(const Image&) = delete;
+        void operator=(const Image&) = delete;
+
+        bool parse(const uint8_t* data, size_t length) {
+            const uint8_t* end = data + length;
+            if (length < 3 || memcmp(data, "P7\n", 3) != 0) {
+                m_errorMessage = "Not a PAM file";
+                return false;
+            }
+            data += 3;
+
+            unsigned long width = 0, height = 0, depth = 0, maxval = 0;
+            while (data < end) {
+                const uint8_t* lineEnd = static_cast<const uint8_t*>(memchr(data, '\n', end - data));
+                if (!lineEnd)
+                    break;
+                const std::string line(reinterpret_cast<const char*>(data), lineEnd - data);
+                data = lineEnd + 1;
+
+                if (line.empty() || line[0] == '#' || line.compare(0, 8, "TUPLTYPE") == 0)
+                    continue;
+                if (line == "ENDHDR") {
+                    if (depth < 3 || depth > 4 || maxval != 255 || !width || !height) {
+                        m_errorMessage = "Unsupported PAM format";
+                        return false;
+                    }
+                    if (width > maximumSize || height > maximumSize) {
+                        m_errorMessage = "PAM image too large";
+                        return false;
+                    }
+                    m_width = width;
+                    m_height = height;
+                    return readPixels(data, end, depth);
+                }
+
+                const auto separator = line.find(' ');
+                if (separator == std::string::npos)
+                    continue;
+                const auto value = std::strtoul(line.c_str() + separator + 1, nullptr, 10);
+                const auto key = line.substr(0, separator);
+                if (key == "WIDTH")
+                    width = value;
+                else if (key == "HEIGHT")
+                    height = value;
+                else if (key == "DEPTH")
+                    depth = value;
+                else if (key == "MAXVAL")
+                    maxval = value;
+            }
+
+            m_errorMessage = "Truncated PAM header";
+            return false;
+        }
+
+        bool readPixels(const uint8_t* data, const uint8_t* end, uint32_t depth) {
+            size_t count, length;
+            if (!g_size_checked_mul(&count, m_width, m_height) || !g_size_checked_mul(&length, count, depth)) {
+                m_errorMessage = "PAM image too large";
+                return false;
+            }
+            if (static_cast<size_t>(end - data) < length) {
+                m_errorMessage = "Truncated PAM data";
+                return false;
+            }
+
+            m_pixels.resize(count);
+            for (size_t i = 0; i < count; i++, data += depth) {
+                const uint32_t alpha = (depth == 4) ? data[3] : 0xFF;
+                m_pixels[i] = (alpha << 24)
+                    | (premultiply(data[0], alpha) << 16)
+                    | (premultiply(data[1], alpha) << 8)
+                    | premultiply(data[2], alpha);
+            }
+            return true;
+        }
+
+        static inline uint32_t premultiply(uint32_t value, uint32_t alpha) {
+            return (value * alpha + 127) / 255;
+        }
+
+        std::vector<uint32_t> m_pixels;
+        uint32_t m_width { 0 };
+        uint32_t m_height { 0 };
+        const char* m_errorMessage { nullptr };
+    };
+
+} // namespace overlay
+
+#endif /* !OVERLAY_HH */
@@ -0,0 +1,242 @@
+/*
+ * perf.hh
+ * Copyright (C) 2017 Adrian Perez <aperez@igalia.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef PERF_HH
+#define PERF_HH
+
+#include <glib.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <cerrno>
+#include <cstring>
+
+namespace perf {
+
+    enum Event {
+        Cycles = 0,
+        Instructions,
+        CacheMisses,
+        DTLBMisses,
+        StalledCycles,
+        EventCount,
+    };
+
+    struct Sample {
+        uint64_t value[EventCount];
+        uint64_t timeEnabled;
+        uint64_t timeRunning;
+    };
+
+
+    /*
+     * Group of hardware counters for the calling thread. Events that the
+     * kernel or the PMU do not support are left out, and report zero.
+     */
+    class Counters {
+    public:
+        Counters() = default;
+
+        ~Counters() {
+            for (auto& fd : m_fd) {
+                if (fd != -1) {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+        }
+
+        bool open() {
+            static const struct {
+                uint32_t type;
+                uint64_t config;
+            } events[EventCount] = {
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+                { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND },
+            };
+
+            for (unsigned i = 0; i < EventCount; i++) {
+                struct perf_event_attr attr { };
+                attr.size = sizeof(attr);
+                attr.type = events[i].type;
+                attr.config = events[i].config;
+                attr.read_format = PERF_FORMAT_GROUP |
+                                   PERF_FORMAT_TOTAL_TIME_ENABLED |
+                                   PERF_FORMAT_TOTAL_TIME_RUNNING;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.disabled = (m_leader == -1);
+
+                int fd = syscall(__NR_perf_event_open, &attr, 0, -1, m_leader, 0);
+                if (fd == -1) {
+                    if (i == Cycles) {
+                        m_errno = errno;
+                        return false;
+                    }
+                    continue;
+                }
+                if (m_leader == -1)
+                    m_leader = fd;
+                m_fd[i] = fd;
+                m_slot[i] = m_opened++;
+            }
+
+            ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            return true;
+        }
+
+        inline bool isOpen() const { return m_leader != -1; }
+        inline bool supports(Event event) const { return m_fd[event] != -1; }
+        inline const char* errorMessage() const { return strerror(m_errno); }
+
+        bool read(Sample& sample) const {
+            // Layout: nr, time_enabled, time_running, values[nr].
+            uint64_t data[3 + EventCount];
+            ssize_t length;
+            do {
+                length = ::read(m_leader, data, sizeof(data));
+            } while (length < 0 && errno == EINTR);
+            if (length < static_cast<ssize_t>(sizeof(uint64_t) * (3 + m_opened)))
+                return false;
+
+            sample.timeEnabled = data[1];
+            sample.timeRunning = data[2];
+            for (unsigned i = 0; i < EventCount; i++)
+                sample.value[i] = (m_fd[i] == -1) ? 0 : data[3 + m_slot[i]];
+            return true;
+        }
+
+    private:
+        Counters(const Counters&) = delete;
+        void operator=(const Counters&) = delete;
+
+        int m_fd[EventCount] { -1, -1, -1, -1, -1 };
+        unsigned m_slot[EventCount] { };
+        unsigned m_opened { 0 };
+        int m_leader { -1 };
+        int m_errno { 0 };
+    };
+
+
+    /*
+     * Accumulates counter deltas for each named stage of the frame export,
+     * to be reported as per-frame averages. Per-pixel figures are relative
+     * to the pixels each stage actually processed. Frames in which reading
+     * the counters failed are left out. When the PMU multiplexes the group,
+     * values are scaled by the ratio of enabled to running time.
+     */
+    template <unsigned N>
+    class Profile {
+    public:
+        explicit Profile(const char* const (&stageNames)[N]) : m_stageNames(stageNames) { }
+
+        inline bool open() { return m_counters.open(); }
+        inline bool isOpen() const { return m_counters.isOpen(); }
+        inline const Counters& counters() const { return m_counters; }
+
+        inline void begin() {
+            memset(m_frame, 0x00, sizeof(m_frame));
+            memset(m_framePixels, 0x00, sizeof(m_framePixels));
+            m_valid = m_counters.read(m_start);
+        }
+
+        void end(unsigned stage, uint64_t pixels) {
+            if (!m_valid)
+                return;
+
+            Sample now;
+            if (!m_counters.read(now)) {
+                m_valid = false;
+                return;
+            }
+            for (unsigned i = 0; i < EventCount; i++)
+                m_frame[stage].value[i] += now.value[i] - m_start.value[i];
+            m_frame[stage].timeEnabled += now.timeEnabled - m_start.timeEnabled;
+            m_frame[stage].timeRunning += now.timeRunning - m_start.timeRunning;
+            m_framePixels[stage] += pixels;
+            m_start = now;
+        }
+
+        void frame() {
+            if (!m_valid) {
+                m_invalidFrames++;
+                return;
+            }
+            for (unsigned stage = 0; stage < N; stage++) {
+                for (unsigned i = 0; i < EventCount; i++)
+                    m_total[stage].value[i] += m_frame[stage].value[i];
+                m_total[stage].timeEnabled += m_frame[stage].timeEnabled;
+                m_total[stage].timeRunning += m_frame[stage].timeRunning;
+                m_pixels[stage] += m_framePixels[stage];
+            }
+            m_frames++;
+        }
+
+        void report(const char* backendName) {
+            if (m_invalidFrames) {
+                g_printerr("[perf] %s: could not read counters in %" PRIu64 " frames\n",
+                           backendName, m_invalidFrames);
+                m_invalidFrames = 0;
+            }
+            if (!m_frames)
+                return;
+
+            for (unsigned stage = 0; stage < N; stage++) {
+                if (!m_total[stage].timeRunning) {
+                    g_printerr("[perf] %s/%-8s counters were not scheduled"
+                               " (too many events for the PMU?)\n",
+                               backendName, m_stageNames[stage]);
+                    continue;
+                }
+
+                const double scale = static_cast<double>(m_total[stage].timeEnabled) / m_total[stage].timeRunning;
+                double total[EventCount];
+                for (unsigned i = 0; i < EventCount; i++)
+                    total[i] = m_total[stage].value[i] * scale;
+
+                const double pixels = m_pixels[stage] ? static_cast<double>(m_pixels[stage]) : 1.0;
+                g_printerr("[perf] %s/%-8s %10.0f cycles/frame, IPC %4.2f, %10.0f px/frame,"
+                           " %.4f cache-misses/px, %.4f dTLB-misses/px, %4.1f%% stalled\n",
+                           backendName,
+                           m_stageNames[stage],
+                           total[Cycles] / m_frames,
+                           total[Cycles] ? total[Instructions] / total[Cycles] : 0.0,
+                           static_cast<double>(m_pixels[stage]) / m_frames,
+                           total[CacheMisses] / pixels,
+                           total[DTLBMisses] / pixels,
+                           total[Cycles] ? 100.0 * total[StalledCycles] / total[Cycles] : 0.0);
+            }
+
+            memset(m_total, 0x00, sizeof(m_total));
+            memset(m_pixels, 0x00, sizeof(m_pixels));
+            m_frames = 0;
+        }
+
+    private:
+        Counters m_counters;
+        const char* const (&m_stageNames)[N];
+        Sample m_start { };
+        Sample m_frame[N] { };
+        Sample m_total[N] { };
+        uint64_t m_framePixels[N] { };
+        uint64_t m_pixels[N] { };
+        bool m_valid { false };
+        uint64_t m_invalidFrames { 0 };
+        uint64_t m_frames { 0 };
+    };
+
+} // namespace perf
+
+#endif /* !PERF_HH */
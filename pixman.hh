@@ -46,6 +46,18 @@ namespace pixman {
         T* m_pointer;
     };
 
+    enum Rotation {
+        None = 0,
+        ClockWise90,
+        ClockWise180,
+        ClockWise270,
+        ClockWise360 = None,
+        CounterClockWise90 = ClockWise270,
+        CounterClockWise180 = ClockWise180,
+        CounterClockWise270 = ClockWise90,
+        CounterClockWise360 = None,
+    };
+
     class Transform;
 
     class Surface : public Ref<pixman_image_t,
@@ -94,6 +106,37 @@ namespace pixman {
             return rotate(std::cos(d), std::sin(d));
         }
 
+        // Maps destination coordinates back into a width x height source
+        // which is displayed rotated by the given angle.
+        static Transform rotate(Rotation angle, uint32_t width, uint32_t height) {
+            Transform xfrm = identity();
+            auto& m = xfrm.m_transform.m;
+            switch (angle) {
+                case Rotation::ClockWise90:
+                    m[0][0] = 0;  m[0][1] = 1; m[0][2] = 0;
+                    m[1][0] = -1; m[1][1] = 0; m[1][2] = height;
+                    break;
+                case Rotation::ClockWise180:
+                    m[0][0] = -1; m[0][1] = 0;  m[0][2] = width;
+                    m[1][0] = 0;  m[1][1] = -1; m[1][2] = height;
+                    break;
+                case Rotation::ClockWise270:
+                    m[0][0] = 0; m[0][1] = -1; m[0][2] = width;
+                    m[1][0] = 1; m[1][1] = 0;  m[1][2] = 0;
+                    break;
+                default:  // No rotation.
+                    break;
+            }
+            return xfrm;
+        }
+
+        // Offsets the coordinates produced by the transform.
+        inline Transform& translate(double x, double y) {
+            m_transform.m[0][2] += x;
+            m_transform.m[1][2] += y;
+            return *this;
+        }
+
     private:
         Transform() = default;
 
@@ -0,0 +1,255 @@
+/*
+ * scroll.hh
+ * Copyright (C) 2017 Adrian Perez <aperez@igalia.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef SCROLL_HH
+#define SCROLL_HH
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE4_1__)
+# include <smmintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
+
+namespace scroll {
+
+    /*
+     * Row hashing. Each row is consumed as 32-bit words spread over four
+     * lanes, and each lane runs the MurmurHash3 block mix: every word is
+     * multiplied and rotated before being folded into the lane state, so
+     * that the hash is not linear in the pixel values. The SIMD variants
+     * and the scalar fallback produce the same values, the lanes are
+     * folded with a 64-bit finalizer.
+     */
+
+    constexpr uint32_t hashC1 = 0xcc9e2d51;
+    constexpr uint32_t hashC2 = 0x1b873593;
+    constexpr uint32_t hashC3 = 0xe6546b64;
+
+    static inline uint32_t rotl32(uint32_t value, unsigned bits) {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    static inline uint32_t mixWord(uint32_t state, uint32_t word) {
+        word = rotl32(word * hashC1, 15) * hashC2;
+        return rotl32(state ^ word, 13) * 5 + hashC3;
+    }
+
+    static inline uint64_t mix64(uint64_t value) {
+        value ^= value >> 33;
+        value *= UINT64_C(0xff51afd7ed558ccd);
+        value ^= value >> 33;
+        value *= UINT64_C(0xc4ceb9fe1a85ec53);
+        value ^= value >> 33;
+        return value;
+    }
+
+#if defined(__SSE2__)
+    static inline __m128i mullo32(__m128i a, __m128i b) {
+# if defined(__SSE4_1__)
+        return _mm_mullo_epi32(a, b);
+# else
+        __m128i even = _mm_mul_epu32(a, b);
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+# endif
+    }
+
+    static inline __m128i rotl32x4(__m128i value, int bits) {
+        return _mm_or_si128(_mm_slli_epi32(value, bits), _mm_srli_epi32(value, 32 - bits));
+    }
+#endif
+
+    static inline uint64_t hashRow(const void* data, uint32_t words) {
+        const uint32_t* word = static_cast<const uint32_t*>(data);
+        uint32_t state[4] = { 0, 0, 0, 0 };
+        uint32_t i = 0;
+
+#if defined(__SSE2__)
+        const __m128i c1 = _mm_set1_epi32(hashC1);
+        const __m128i c2 = _mm_set1_epi32(hashC2);
+        const __m128i c3 = _mm_set1_epi32(hashC3);
+        const __m128i five = _mm_set1_epi32(5);
+        __m128i vstate = _mm_setzero_si128();
+        for (; i + 4 <= words; i += 4) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(word + i));
+            block = mullo32(rotl32x4(mullo32(block, c1), 15), c2);
+            vstate = rotl32x4(_mm_xor_si128(vstate, block), 13);
+            vstate = _mm_add_epi32(mullo32(vstate, five), c3);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(state), vstate);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        const uint32x4_t c3 = vdupq_n_u32(hashC3);
+        uint32x4_t vstate = vdupq_n_u32(0);
+        for (; i + 4 <= words; i += 4) {
+            uint32x4_t block = vmulq_n_u32(vld1q_u32(word + i), hashC1);
+            block = vmulq_n_u32(vsriq_n_u32(vshlq_n_u32(block, 15), block, 17), hashC2);
+            vstate = veorq_u32(vstate, block);
+            vstate = vsriq_n_u32(vshlq_n_u32(vstate, 13), vstate, 19);
+            vstate = vaddq_u32(vmulq_n_u32(vstate, 5), c3);
+        }
+        vst1q_u32(state, vstate);
+#endif
+
+        for (; i + 4 <= words; i += 4) {
+            for (unsigned lane = 0; lane < 4; lane++)
+                state[lane] = mixWord(state[lane], word[i + lane]);
+        }
+        for (unsigned lane = 0; i < words; i++, lane++)
+            state[lane] = mixWord(state[lane], word[i]);
+
+        uint64_t hash = words;
+        for (unsigned lane = 0; lane < 4; lane++)
+            hash = mix64(hash ^ state[lane]);
+        return hash;
+    }
+
+
+    /*
+     * Rows [top, bottom) of the new frame are a copy of rows
+     * [top + delta, bottom + delta) of the previous frame. An empty
+     * band (top == bottom) means that the whole frame has to be
+     * converted again.
+     */
+    struct Result {
+        int32_t delta;
+        uint32_t top;
+        uint32_t bottom;
+
+        inline uint32_t rows() const { return bottom - top; }
+        inline bool empty() const { return top == bottom; }
+
+        // Removes rows [first, end) from the band, keeping the larger of
+        // the parts left at each side.
+        void exclude(int64_t first, int64_t end) {
+            if (end <= top || first >= bottom)
+                return;
+            const int64_t above = first - top;
+            const int64_t below = bottom - end;
+            if (above <= 0 && below <= 0) {
+                top = bottom = 0;
+            } else if (above >= below) {
+                bottom = first;
+            } else {
+                top = end;
+            }
+            if (empty())
+                delta = 0;
+        }
+    };
+
+
+    class Detector {
+    public:
+        // Fraction (as a divisor of the frame height) that a band must
+        // cover to be considered worth moving instead of reconverting.
+        constexpr static uint32_t minimumBandDivisor = 2;
+
+        Result update(const void* data, uint32_t width, uint32_t height, uint32_t stride) {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+            m_current.resize(height);
+            for (uint32_t y = 0; y < height; y++)
+                m_current[y] = hashRow(bytes + static_cast<size_t>(stride) * y, width);
+
+            Result best { 0, 0, 0 };
+            if (m_previous.size() == height && m_width == width && height > 0) {
+                best = evaluate(0);
+
+                // Anchor rows are sampled around the middle of the frame; rows
+                // identical to their neighbours (i.e. solid backgrounds) are
+                // skipped because they would match anywhere.
+                static const uint32_t anchorFractions[][2] = {
+                    { 1, 2 }, { 1, 3 }, { 2, 3 }, { 1, 4 }, { 3, 4 },
+                };
+                for (const auto& fraction : anchorFractions) {
+                    if (best.delta == 0 && best.rows() == height)
+                        break;  // Frame did not change at all.
+
+                    uint32_t anchor = height * fraction[0] / fraction[1];
+                    if (!findDistinctRow(anchor))
+                        continue;
+
+                    int32_t delta;
+                    if (!findInPrevious(anchor, delta) || delta == 0)
+                        continue;
+
+                    auto candidate = evaluate(delta);
+                    if (candidate.rows() > best.rows())
+                        best = candidate;
+                }
+
+                if (best.rows() < height / minimumBandDivisor)
+                    best = { 0, 0, 0 };
+            }
+
+            m_width = width;
+            m_previous.swap(m_current);
+            return best;
+        }
+
+    private:
+        bool findDistinctRow(uint32_t& row) const {
+            const uint32_t height = m_current.size();
+            for (; row + 1 < height; row++) {
+                if (row == 0)
+                    continue;
+                if (m_current[row] != m_current[row - 1] && m_current[row] != m_current[row + 1])
+                    return true;
+            }
+            return false;
+        }
+
+        bool findInPrevious(uint32_t row, int32_t& delta) const {
+            const int32_t height = m_previous.size();
+            const int32_t start = row;
+            const uint64_t hash = m_current[row];
+            for (int32_t distance = 1; distance < height; distance++) {
+                if (start + distance < height && m_previous[start + distance] == hash) {
+                    delta = distance;
+                    return true;
+                }
+                if (start - distance >= 0 && m_previous[start - distance] == hash) {
+                    delta = -distance;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        Result evaluate(int32_t delta) const {
+            const int32_t height = m_current.size();
+            const int32_t begin = (delta < 0) ? -delta : 0;
+            const int32_t end = (delta > 0) ? height - delta : height;
+
+            Result best { delta, 0, 0 };
+            int32_t runStart = begin;
+            for (int32_t y = begin; y <= end; y++) {
+                if (y < end && m_current[y] == m_previous[y + delta])
+                    continue;
+                if (static_cast<uint32_t>(y - runStart) > best.rows()) {
+                    best.top = runStart;
+                    best.bottom = y;
+                }
+                runStart = y + 1;
+            }
+            return best;
+        }
+
+        std::vector<uint64_t> m_previous;
+        std::vector<uint64_t> m_current;
+        uint32_t m_width { 0 };
+    };
+
+} // namespace scroll
+
+#endif /* !SCROLL_HH */
@@ -8,7 +8,16 @@
 #ifndef SIMPLEGFX_HH
 #define SIMPLEGFX_HH
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
 
 namespace simplegfx {
     constexpr static const char* name = "simplegfx";
@@ -19,6 +28,209 @@ namespace simplegfx {
                                      (((argb >>  3) & 0x1F) <<  0));
     }
 
+    // Same numbering as the FB_ROTATE_* constants from <linux/fb.h>.
+    enum Rotation {
+        None = 0,
+        ClockWise90,
+        ClockWise180,
+        ClockWise270,
+        CounterClockWise90 = ClockWise270,
+        CounterClockWise180 = ClockWise180,
+        CounterClockWise270 = ClockWise90,
+    };
+
+    // Premultiplied ARGB32 image composited over the source, in source coordinates.
+    struct Overlay {
+        const uint32_t* data;
+        uint32_t stride;
+        int32_t x;
+        int32_t y;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // Premultiplied "over": d = s + d * (255 - sa) / 255, for each channel.
+    static inline uint32_t blendOver(uint32_t s, uint32_t d) {
+        const uint32_t inverseAlpha = 255 - (s >> 24);
+        uint32_t result = 0;
+        for (unsigned shift = 0; shift < 32; shift += 8) {
+            uint32_t t = ((d >> shift) & 0xFF) * inverseAlpha + 128;
+            t = ((t + (t >> 8)) >> 8) + ((s >> shift) & 0xFF);
+            result |= ((t > 0xFF) ? 0xFF : t) << shift;
+        }
+        return result;
+    }
+
+    static inline void blendOverSpan(uint32_t* destination, const uint32_t* source, uint32_t count) {
+        uint32_t i = 0;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i mask = _mm_set1_epi16(0xFF);
+        const __m128i half = _mm_set1_epi16(0x80);
+        auto blendHalf = [&](__m128i s, __m128i d) {
+            __m128i a = _mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm_sub_epi16(mask, _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3)));
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, a), half);
+            t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+            return _mm_add_epi16(s, t);
+        };
+        for (; i + 4 <= count; i += 4) {
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(destination + i));
+            __m128i lo = blendHalf(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+            __m128i hi = blendHalf(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_packus_epi16(lo, hi));
+        }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        for (; i + 4 <= count; i += 4) {
+            uint32x4_t s32 = vld1q_u32(source + i);
+            uint8x16_t s = vreinterpretq_u8_u32(s32);
+            uint8x16_t d = vreinterpretq_u8_u32(vld1q_u32(destination + i));
+            uint8x16_t a = vmvnq_u8(vreinterpretq_u8_u32(vmulq_n_u32(vshrq_n_u32(s32, 24), 0x01010101)));
+            uint16x8_t lo = vmull_u8(vget_low_u8(d), vget_low_u8(a));
+            uint16x8_t hi = vmull_u8(vget_high_u8(d), vget_high_u8(a));
+            uint8x16_t t = vcombine_u8(vrshrn_n_u16(vrsraq_n_u16(lo, lo, 8), 8),
+                                       vrshrn_n_u16(vrsraq_n_u16(hi, hi, 8), 8));
+            vst1q_u32(destination + i, vreinterpretq_u32_u8(vqaddq_u8(s, t)));
+        }
+#endif
+        for (; i < count; i++)
+            destination[i] = blendOver(source[i], destination[i]);
+    }
+
+    // Side of the square blocks in which quarter turns are transposed. The
+    // source lines of a block stay in cache while its destination lines are
+    // written, and each destination line of a block is a whole 64-byte line
+    // of RGB565 pixels, which suits write-combined framebuffer memory.
+    constexpr uint32_t tileSize = 32;
+
+    // Calls "function(firstX, endX, firstY, endY)" for each block of rows
+    // [firstRow, endRow), walking the blocks of each band of rows in turn.
+    template <typename F>
+    static inline void forEachTile(uint32_t width, uint32_t firstRow, uint32_t endRow, F function) {
+        for (uint32_t tileY = firstRow; tileY < endRow; tileY += tileSize) {
+            const uint32_t tileEndY = std::min(tileY + tileSize, endRow);
+            for (uint32_t tileX = 0; tileX < width; tileX += tileSize)
+                function(tileX, std::min(tileX + tileSize, width), tileY, tileEndY);
+        }
+    }
+
+    /*
+     * Converts rows [firstRow, endRow) of an ARGB32 image into an RGB565
+     * destination, rotating by the given angle. With no rotation or a half
+     * turn each source row is converted straight into a destination line;
+     * quarter turns are transposed in tileSize x tileSize blocks, so that
+     * each block reads the source and writes the destination sequentially.
+     *
+     * Source rows covered by overlays are first blended into a scratch
+     * copy, so the overlays are composited within the conversion pass.
+     */
+    static void convertRows(const void* source,
+                            uint32_t sourceStride,
+                            uint32_t width,
+                            uint32_t height,
+                            void* destination,
+                            uint32_t destinationStride,
+                            Rotation rotation,
+                            uint32_t firstRow,
+                            uint32_t endRow,
+                            const Overlay* overlays = nullptr,
+                            unsigned overlayCount = 0)
+    {
+        const uint8_t* src = static_cast<const uint8_t*>(source);
+        uint8_t* dst = static_cast<uint8_t*>(destination);
+
+        auto coveredSpan = [&](const Overlay& overlay, uint32_t y, int32_t& begin, int32_t& end) {
+            const int32_t overlayRow = static_cast<int32_t>(y) - overlay.y;
+            if (overlayRow < 0 || overlayRow >= static_cast<int32_t>(overlay.height))
+                return false;
+            begin = std::max<int32_t>(overlay.x, 0);
+            end = std::min<int64_t>(static_cast<int64_t>(overlay.x) + overlay.width, width);
+            return begin < end;
+        };
+
+        // Pointers to each source line, which for lines under an overlay
+        // point to a blended copy in the scratch buffer.
+        static thread_local std::vector<const uint32_t*> lines;
+        static thread_local std::vector<uint32_t> scratch;
+        lines.resize(endRow - firstRow);
+
+        uint32_t blendedLines = 0;
+        for (uint32_t y = firstRow; y < endRow; y++) {
+            int32_t begin, end;
+            lines[y - firstRow] = reinterpret_cast<const uint32_t*>(src + sourceStride * y);
+            for (unsigned i = 0; i < overlayCount; i++) {
+                if (coveredSpan(overlays[i], y, begin, end)) {
+                    lines[y - firstRow] = nullptr;
+                    blendedLines++;
+                    break;
+                }
+            }
+        }
+
+        if (blendedLines) {
+            scratch.resize(static_cast<size_t>(blendedLines) * width);
+            uint32_t* blended = scratch.data();
+            for (uint32_t y = firstRow; y < endRow; y++) {
+                if (lines[y - firstRow])
+                    continue;
+                std::memcpy(blended, src + sourceStride * y, width * sizeof(uint32_t));
+                for (unsigned i = 0; i < overlayCount; i++) {
+                    const auto& overlay = overlays[i];
+                    int32_t begin, end;
+                    if (!coveredSpan(overlay, y, begin, end))
+                        continue;
+                    auto* overlayLine = reinterpret_cast<const uint32_t*>(
+                        reinterpret_cast<const uint8_t*>(overlay.data) + overlay.stride * (y - overlay.y));
+                    blendOverSpan(blended + begin, overlayLine + (begin - overlay.x), end - begin);
+                }
+                lines[y - firstRow] = blended;
+                blended += width;
+            }
+        }
+
+        auto sourceLine = [&](uint32_t y) { return lines[y - firstRow]; };
+
+        switch (rotation) {
+            case Rotation::None:
+                for (uint32_t y = firstRow; y < endRow; y++) {
+                    auto* srcLine = sourceLine(y);
+                    auto* dstLine = reinterpret_cast<uint16_t*>(dst + destinationStride * y);
+                    for (uint32_t x = 0; x < width; x++)
+                        dstLine[x] = Argb32toRgb565_v0(srcLine[x]);
+                }
+                break;
+            case Rotation::ClockWise180:
+                for (uint32_t y = firstRow; y < endRow; y++) {
+                    auto* srcLine = sourceLine(y);
+                    auto* dstLine = reinterpret_cast<uint16_t*>(dst + destinationStride * (height - 1 - y));
+                    for (uint32_t x = 0; x < width; x++)
+                        dstLine[width - 1 - x] = Argb32toRgb565_v0(srcLine[x]);
+                }
+                break;
+            case Rotation::ClockWise90:
+                // Source pixel (x, y) becomes destination pixel (height - 1 - y, x).
+                forEachTile(width, firstRow, endRow, [&](uint32_t firstX, uint32_t endX, uint32_t firstY, uint32_t endY) {
+                    for (uint32_t x = firstX; x < endX; x++) {
+                        auto* dstLine = reinterpret_cast<uint16_t*>(dst + destinationStride * x) + (height - 1);
+                        for (uint32_t y = firstY; y < endY; y++)
+                            dstLine[-static_cast<int32_t>(y)] = Argb32toRgb565_v0(sourceLine(y)[x]);
+                    }
+                });
+                break;
+            case Rotation::ClockWise270:
+                // Source pixel (x, y) becomes destination pixel (y, width - 1 - x).
+                forEachTile(width, firstRow, endRow, [&](uint32_t firstX, uint32_t endX, uint32_t firstY, uint32_t endY) {
+                    for (uint32_t x = firstX; x < endX; x++) {
+                        auto* dstLine = reinterpret_cast<uint16_t*>(dst + destinationStride * (width - 1 - x));
+                        for (uint32_t y = firstY; y < endY; y++)
+                            dstLine[y] = Argb32toRgb565_v0(sourceLine(y)[x]);
+                    }
+                });
+                break;
+        }
+    }
+
 } // namespace simplegfx
 
 #endif /* !SIMPLEGFX_HH */